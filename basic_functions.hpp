@@ -5,6 +5,8 @@
 #include <numeric>
 #include <iostream>
 #include <vector>
+#include <cassert>
+#include <algorithm>
 #include <atcoder/modint>
 
 // @return x mod m
@@ -23,6 +25,15 @@ long long mypow(const long long a,const long long b){
     return r;
 }
 
+// @return the nearest integer to a/b (b>0)
+template<typename T>
+T round_div(T a,T b){
+    assert(b>0);
+    T q=(2*a+b)/(2*b);
+    if((2*a+b)%(2*b)<0)q--;
+    return q;
+}
+
 // @return pair(x,y) s.t. ax+by=|gcd(a,b)|
 std::pair<long long,long long> solve_lineareq(long long a,long long b){
     if(b==0)return {(a>0 ? 1:-1),0};
@@ -40,14 +51,105 @@ long long garner(long long a1,long long m1,long long a2,long long m2){
         return -1;
     }
     else{
-        long long p=solve_lineareq(m1,m2).first;
-        return MOD(a1+(a2-a1)/g*m1*p,m1/g*m2);
+        //途中の値をmod m2/gで抑える（lcm(m1,m2)^2がlong longに収まれば良い）
+        const long long m=m2/g;
+        const long long p=solve_lineareq(m1,m2).first;
+        return MOD(a1+MOD((a2-a1)/g%m*(p%m),m)*m1,m1/g*m2);
     }
 }
 
+// @return the Jacobi symbol (a/n) (n: odd, positive)
+int jacobi(long long a,long long n){
+    assert(n>0 && n%2==1);
+    a=MOD(a,n);
+    int res=1;
+    while(a!=0){
+        while(a%2==0){
+            a/=2;
+            if(n%8==3 || n%8==5)res=-res;
+        }
+        std::swap(a,n);
+        if(a%4==3 && n%4==3)res=-res;
+        a%=n;
+    }
+    return (n==1 ? res:0);
+}
+
+// @return a*b mod m (0<=a,b<m)
+long long mulmod(const long long a,const long long b,const long long m){
+    return __int128(a)*b%m;
+}
+
+// @return a^n mod m
+long long powmod(long long a,long long n,const long long m){
+    long long res=1%m;
+    a=MOD(a,m);
+    while(n){
+        if(n&1)res=mulmod(res,a,m);
+        a=mulmod(a,a,m);
+        n/=2;
+    }
+    return res;
+}
+
+// Miller-Rabin. 基底を最初の12個の素数とすると2^64未満で決定的．
+// @return true iff x is prime.
+bool is_prime(const long long x){
+    if(x<2)return false;
+    for(long long p:{2,3,5,7,11,13,17,19,23,29,31,37}){
+        if(x%p==0)return x==p;
+    }
+    long long q=x-1;
+    int s=0;
+    while(q%2==0)q/=2,s++;
+    for(long long a:{2,3,5,7,11,13,17,19,23,29,31,37}){
+        long long y=powmod(a,q,x);
+        if(y==1 || y==x-1)continue;
+        bool composite=true;
+        for(int i=1;i<s && composite;i++){
+            y=mulmod(y,y,x);
+            if(y==x-1)composite=false;
+        }
+        if(composite)return false;
+    }
+    return true;
+}
+
+// Pollard's rho (Brentの変形)．仮定：xは奇数の合成数．
+// @return a nontrivial divisor of x.
+long long pollard_rho(const long long x){
+    for(long long c=1;;c++){
+        auto f=[&](const long long y){return (mulmod(y,y,x)+c)%x;};
+        long long y=2,z=2,g=1,q=1,ys=2;
+        const int M=128;
+        for(long long r=1;g==1;r*=2){
+            z=y;
+            for(long long i=0;i<r;i++)y=f(y);
+            for(long long k=0;k<r && g==1;k+=M){
+                ys=y;
+                for(long long i=0;i<M && i<r-k;i++){
+                    y=f(y);
+                    q=mulmod(q,(z>y ? z-y:y-z),x);
+                }
+                g=std::gcd(q,x);
+            }
+        }
+        //まとめてgcdを取ったため1つずつ戻って探す
+        if(g==x){
+            do{
+                ys=f(ys);
+                g=std::gcd((z>ys ? z-ys:ys-z),x);
+            }while(g==1);
+        }
+        if(g!=x)return g;
+    }
+}
+
+//小さい素因数は試し割りで，残りはPollard's rhoで求める．xは2^63未満．
+// @return the vector of pairs(p,i) s.t. x is a product of p^i, sorted by p.
 std::vector<std::pair<long long,int>> prime_factorize(long long x){
     std::vector<std::pair<long long,int>> res;
-    for(long long i=2;i*i<=x;i++){
+    for(long long i=2;i<(1<<10) && i*i<=x;i++){
         int cnt=0;
         while(x%i==0){
             cnt++;
@@ -55,7 +157,24 @@ std::vector<std::pair<long long,int>> prime_factorize(long long x){
         }
         if(cnt)res.emplace_back(i,cnt);
     }
-    if(x!=1)res.emplace_back(x,1);
+    if(x==1)return res;
+    //残りの素因数は全て2^10以上
+    std::vector<long long> rest,st{x};
+    while(!st.empty()){
+        const long long y=st.back();st.pop_back();
+        if(is_prime(y) || y<(1LL<<20)){
+            rest.push_back(y);
+            continue;
+        }
+        const long long z=pollard_rho(y);
+        st.push_back(z);
+        st.push_back(y/z);
+    }
+    std::sort(rest.begin(),rest.end());
+    for(long long p:rest){
+        if(!res.empty() && res.back().first==p)res.back().second++;
+        else res.emplace_back(p,1);
+    }
     return res;
 }
 
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <string>
+#include "sqrt_table.hpp"
+
+//使い方：make_sqrt_table d limit path
+//p<limitの各素数について，x^2-d (mod p)の分解型と根をpathに書き出す．
+//生成した表は ring_of_integer<d>::table に設定して使う．
+
+int main(int argc,char **argv){
+    if(argc!=4){
+        std::cerr << "usage: " << argv[0] << " d limit path" << std::endl;
+        return 1;
+    }
+    const long long d=std::stoll(argv[1]);
+    const unsigned long long limit=std::stoull(argv[2]);
+    if(limit>(1ull<<32)){
+        std::cerr << "limit must be at most 2^32" << std::endl;
+        return 1;
+    }
+    if(!sqrt_table_sp::write_table(d,limit,argv[3])){
+        std::cerr << "failed to write " << argv[3] << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -7,6 +7,8 @@
 #include <cassert>
 #include <atcoder/modint>
 #include <random>
+#include <algorithm>
+#include <limits>
 #include "basic_functions.hpp"
 
 //F_pでの計算に用いる時，必ず polynomial::init(p) を実行する．
@@ -221,11 +223,17 @@ struct ideal : vector<polynomial<T>> {
             g[i-1]=std::gcd(now[i][0],now[i][1]);
             long long gcd=std::gcd(now[i][1],now[i][0]);
             auto [s,t]=solve_lineareq(now[i][1],now[i][0]);
-            t%=now[i][1]/gcd;
-            s=(1-now[i][0]/gcd*t)/(now[i][1]/gcd);
+            //整数の生成元（xの係数が0）の場合はs=0,t=±1のままで良い
+            if(now[i][1]!=0){
+                t%=now[i][1]/gcd;
+                s=(1-now[i][0]/gcd*t)/(now[i][1]/gcd);
+            }
             assert(s*now[i][1] + t*now[i][0] == gcd);
             c[i-1]=now[i][0]*s+now[i][1]*t*d;
-            n[i-1]=std::abs(now[i][1]*now[i][1]*d - now[i][0]*now[i][0])/g[i-1];
+            //生成元のノルムがTに収まらない場合は正しく計算できない
+            const __int128 norm=__int128(now[i][1])*now[i][1]*d - __int128(now[i][0])*now[i][0];
+            assert(norm<=std::numeric_limits<T>::max() && -norm<=std::numeric_limits<T>::max());
+            n[i-1]=(g[i-1]==0 ? 0:std::abs(T(norm))/g[i-1]);
         }
         //g[0]x[0]+...+g[sz-1]x[sz-1]=1を解く
         vector<T> x(sz);
@@ -239,12 +247,18 @@ struct ideal : vector<polynomial<T>> {
         }
         T c_val=0,n_val=0;
         for(int i=0;i<sz;i++){
-            c_val+=c[i]*x[i];
             n_val=std::gcd(n_val,n[i]);
         }
+        //n_valはイデアルに含まれる整数なので，c_valはmod n_valで計算して良い（係数の増大を防ぐ）
+        for(int i=0;i<sz;i++){
+            if(n_val==0)c_val+=c[i]*x[i];
+            else c_val=(c_val+__int128(c[i]%n_val)*(x[i]%n_val))%n_val;
+        }
         elem lef=elem({c_val,1});
         for(int i=0;i<sz;i++){
-            n_val=std::gcd(n_val, top_reduction_by(now[i+1],lef)[0]);
+            //x+c_valによる剰余の定数項．gcdを取るだけなのでmod n_valで良い
+            if(n_val==0)n_val=std::gcd(n_val, top_reduction_by(now[i+1],lef)[0]);
+            else n_val=std::gcd(n_val, T((now[i+1][0]-__int128(now[i+1][1])*c_val)%n_val));
         }
         lef[0]%=n_val;
         return {lef,{n_val}};
@@ -274,6 +288,53 @@ struct ideal : vector<polynomial<T>> {
 };
 
 
+//ideal::strong_grobner_basis_qfを同じx^2-dを持つcount個のイデアルに対してまとめて行う．
+//イデアルkの生成元はx^2-dと，a[i*count+k]+b[i*count+k]x (0<=i<m) のm個（個数が足りない場合は0で埋める）．
+//各イデアルについて，x^2-dを除いた生成元の係数全体のgcdが1であり，各生成元のノルムがTに収まることが必要．
+//結果(x+c[k],n[k])（0<=c[k]<n[k]）をc,nに書き込む．作業領域はcount個の配列2つのみ．
+//生成元ごとにノルムの計算をまとめて行うだけで，gcdや一次方程式の計算はイデアルごとに行う．
+template<typename T>
+void strong_grobner_basis_qf_batch(const T d,const size_t count,const int m,const T *a,const T *b,T *c,T *n){
+    vector<T> norm(count),g(count,0);
+    std::fill(c,c+count,T(0));
+    std::fill(n,n+count,T(0));
+    for(int i=0;i<m;i++){
+        const T *ai=a+i*count,*bi=b+i*count;
+        //|b^2d-a^2|．分岐のないループ
+        for(size_t k=0;k<count;k++){
+            const __int128 v=__int128(bi[k])*bi[k]*d-__int128(ai[k])*ai[k];
+            assert(v<=std::numeric_limits<T>::max() && -v<=std::numeric_limits<T>::max());
+            norm[k]=T(v<0 ? -v:v);
+        }
+        //(s+tx)(a+bx)=c_i+g_i x を求め，これまでのc+gxと合わせる．
+        //nはイデアルに含まれる整数なので，cは常にmod nで持つ．
+        for(size_t k=0;k<count;k++){
+            const T gi=std::gcd(ai[k],bi[k]);
+            if(gi==0)continue;
+            n[k]=std::gcd(n[k],norm[k]/gi);
+            auto [s,t]=solve_lineareq(bi[k],ai[k]);
+            auto [u,w]=solve_lineareq(g[k],gi);
+            //生成元が0でないのでn[k]>0．各項をmod nに落としてから__int128で掛ける
+            const T ci=(__int128(ai[k]%n[k])*(s%n[k])+__int128(bi[k]%n[k])*(t%n[k])%n[k]*(d%n[k]))%n[k];
+            c[k]=(__int128(c[k]%n[k])*(u%n[k])+__int128(ci)*(w%n[k]))%n[k];
+            g[k]=std::gcd(g[k],gi);
+        }
+    }
+    //各生成元のx+cによる剰余．gcdを取るだけなのでmod nで良い
+    for(int i=0;i<m;i++){
+        const T *ai=a+i*count,*bi=b+i*count;
+        for(size_t k=0;k<count;k++){
+            //n[k]=0は零イデアルの場合のみで，このときa,bも全て0
+            if(n[k])n[k]=std::gcd(n[k],T((ai[k]-__int128(bi[k])*c[k])%n[k]));
+        }
+    }
+    for(size_t k=0;k<count;k++){
+        assert(g[k]==1 && n[k]>0);
+        c[k]%=n[k];
+        if(c[k]<0)c[k]+=n[k];
+    }
+}
+
 template<typename T>
 void print_poly(P<T> x){
     if(x.deg()==-1){
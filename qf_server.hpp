@@ -0,0 +1,371 @@
+#ifndef QF_SERVER
+#define QF_SERVER
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <map>
+#include <functional>
+#include <system_error>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//常駐モード：Unixドメインソケットで1行1リクエストを受け付ける．
+//接続の受信はメインスレッドがpollでまとめて行い，完全な行が届いた接続の分だけを起動時に立てたワーカーに渡す．
+//接続を開いたままのクライアントはワーカーを占有しない．MAX_CLIENTSを超える接続には ERR busy を返して切断する．
+//元のノルムの素因数分解はPollard's rhoで行うので，1リクエストの計算時間は数msで抑えられる．
+//1つの接続で複数のリクエストを続けて送ってよく，応答はリクエストの順に1行ずつ返す．
+//PrimesAboveのキャッシュ（2^20未満の素数のみ）はプロセス内で共有されるため，2回目以降は素数ごとの分解を計算しない．
+//
+//リクエスト（数は全て10進整数，α=√d）：
+// F a0 b0 a1 b1     : イデアル(a0+b0α,a1+b1α)の素イデアル分解
+// E a b             : 元a+bαの素イデアル分解（elem::PrimeFactorize）
+// C a0 b0 a1 b1 x y : イデアル(a0+b0α,a1+b1α)がx+yαを含むか -> 1 または 0
+// R a b r s         : Remainder(a+bα,r+sα) -> x y
+//素イデアル分解の応答は，個数kの後にk組の「P.gen[0].a P.gen[0].b P.gen[1].a P.gen[1].b 指数」を並べたもの．
+//不正なリクエストや，計算の途中の値がlong longに収まらないリクエストには ERR で始まる行を返す．
+//改行を含まないままMAX_LINE byteを超えた接続は ERR を返して切断する．
+
+namespace qf_server_sp{
+
+constexpr size_t MAX_LINE=1<<12;
+constexpr size_t MAX_CLIENTS=1<<10;
+constexpr time_t SEND_TIMEOUT=10;// 秒
+constexpr long long SQRT_MAX=3037000499;// floor(sqrt(2^63-1))
+constexpr __int128 LIM=std::numeric_limits<long long>::max();
+
+// @return a^2+|d|b^2 (LIM+1 if |a| or |b| exceeds SQRT_MAX)
+__int128 norm_bound(const long long a,const long long b,const long long absd){
+    if(a<-SQRT_MAX || a>SQRT_MAX || b<-SQRT_MAX || b>SQRT_MAX)return LIM+1;
+    return __int128(a)*a+__int128(b)*b*absd;
+}
+
+// @return true iff s consists of exactly n integers.
+bool parse(const char *s,long long *v,const int n){
+    for(int i=0;i<n;i++){
+        char *end;
+        errno=0;
+        v[i]=std::strtoll(s,&end,10);
+        if(end==s || errno)return false;
+        s=end;
+    }
+    while(*s==' ' || *s=='\r')s++;
+    return *s=='\0';
+}
+
+template<typename A>
+void append_factorization(std::string &out,const std::vector<std::pair<typename A::ideal,int>> &fac){
+    out+=std::to_string(fac.size());
+    for(auto &&[P,e]:fac){
+        for(auto g:P.gen){
+            out+=' ';
+            out+=std::to_string(g.a);
+            out+=' ';
+            out+=std::to_string(g.b);
+        }
+        out+=' ';
+        out+=std::to_string(e);
+    }
+}
+
+//イデアル(x,y)について，生成元のノルムとその途中の積がlong longに収まり，
+//さらにイデアルのノルムnについてn^2+|d|が収まるか．零イデアルの場合もtrue．
+//（PrimeFactorize・Containsでは，x+c (0<=c<n) のノルムやy*cを計算する）
+// @return the bound of n (0 if the ideal is zero, LIM+1 if it is too large)
+template<typename A>
+__int128 ideal_bound(const typename A::elem x,const typename A::elem y,const long long absd){
+    __int128 m=0;
+    for(auto e:{x,y}){
+        if(e==0)continue;
+        const __int128 b=norm_bound(e.a,e.b,absd);
+        if(b>LIM)return LIM+1;
+        //nは各生成元のノルムを割る
+        const __int128 n=std::abs(e.norm());
+        m=(m==0 ? n:std::min(m,n));
+    }
+    if(m>SQRT_MAX || m*m+absd>LIM)return LIM+1;
+    return m;
+}
+
+template<typename A>
+void handle(const std::string &line,std::string &out){
+    using elem=typename A::elem;
+    using ideal=typename A::ideal;
+    const long long absd=std::abs(elem(0,1).norm());
+    long long v[6];
+    const char *args=line.c_str()+1;
+    const char op=(line.empty() ? '\0':line[0]);
+    if(op=='F' && parse(args,v,4)){
+        const elem x(v[0],v[1]),y(v[2],v[3]);
+        const __int128 m=ideal_bound<A>(x,y,absd);
+        if(m>LIM)out+="ERR overflow";
+        else if(m==0)out+="ERR zero ideal";
+        else append_factorization<A>(out,ideal({x,y}).PrimeFactorize());
+    }
+    else if(op=='E' && parse(args,v,2)){
+        const elem x(v[0],v[1]);
+        if(norm_bound(x.a,x.b,absd)>LIM)out+="ERR overflow";
+        else if(x==0)out+="ERR zero element";
+        else append_factorization<A>(out,x.PrimeFactorize());
+    }
+    else if(op=='C' && parse(args,v,6)){
+        const elem x(v[0],v[1]),y(v[2],v[3]),z(v[4],v[5]);
+        const __int128 m=ideal_bound<A>(x,y,absd);
+        //z.a,z.bと生成元の係数のgcdの積，およびz.a+z.b*c (0<=c<m) が収まる必要がある
+        if(m>LIM || norm_bound(z.a,z.b,absd)>LIM
+           || __int128(std::abs(z.a))+__int128(std::abs(z.b))*m>LIM)out+="ERR overflow";
+        else{
+            ideal I({x,y});
+            out+=(I.Contains(z) ? '1':'0');
+        }
+    }
+    else if(op=='R' && parse(args,v,4)){
+        const elem r(v[2],v[3]);
+        //Remainderは，n=N(r)としてn^2と(|s|+|t|)nまでの積を計算する
+        const __int128 b=norm_bound(r.a,r.b,absd);
+        const __int128 n=(b>LIM ? LIM+1:__int128(std::abs(r.norm())));
+        if(n>SQRT_MAX || (__int128(std::abs(r.a))+__int128(std::abs(r.b))*(absd+1))*n>LIM)out+="ERR overflow";
+        else if(r==0)out+="ERR zero modulus";
+        else{
+            const elem x=Remainder(elem(v[0],v[1]),r);
+            out+=std::to_string(x.a);
+            out+=' ';
+            out+=std::to_string(x.b);
+        }
+    }
+    else out+="ERR bad request";
+    out+='\n';
+}
+
+// @return true iff all of s is sent.
+bool send_all(const int fd,const std::string &s){
+    size_t sent=0;
+    while(sent<s.size()){
+        const ssize_t len=send(fd,s.data()+sent,s.size()-sent,MSG_NOSIGNAL);
+        if(len<0 && errno==EINTR)continue;
+        if(len<=0)return false;
+        sent+=len;
+    }
+    return true;
+}
+
+//ワーカーに渡す仕事：1つの接続で受信済みの完全な行．too_longなら処理後に切断する．
+struct job{
+    int fd;
+    std::string lines;
+    bool too_long;
+};
+
+//スレッド間で受け渡すキュー．
+template<typename V>
+struct channel{
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::queue<V> q;
+
+    void push(V v){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            q.push(std::move(v));
+        }
+        cv.notify_one();
+    }
+    V pop(){
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock,[this]{return !q.empty();});
+        V v=std::move(q.front());
+        q.pop();
+        return v;
+    }
+    // @return false if empty.
+    bool try_pop(V &v){
+        std::lock_guard<std::mutex> lock(mtx);
+        if(q.empty())return false;
+        v=std::move(q.front());
+        q.pop();
+        return true;
+    }
+};
+
+//ワーカー：行を処理して応答をまとめて送り，(fd,接続を続けるか)をdoneに返してwakeに1byte書く．
+template<typename A>
+void worker(channel<job> &jobs,channel<std::pair<int,bool>> &done,const int wake){
+    std::string out;
+    while(true){
+        const job j=jobs.pop();
+        out.clear();
+        size_t start=0,pos;
+        while((pos=j.lines.find('\n',start))!=std::string::npos){
+            handle<A>(j.lines.substr(start,pos-start),out);
+            start=pos+1;
+        }
+        if(j.too_long)out+="ERR line too long\n";
+        const bool keep=send_all(j.fd,out) && !j.too_long;
+        done.push({j.fd,keep});
+        //パイプが一杯ならメインスレッドは既に起こされている
+        const char c=0;
+        while(write(wake,&c,1)<0 && errno==EINTR);
+    }
+}
+
+// @return the exit status. 正常に起動した場合は戻らない．
+template<typename A>
+int serve(const char *path){
+    sockaddr_un addr{};
+    addr.sun_family=AF_UNIX;
+    if(std::strlen(path)>=sizeof(addr.sun_path)){
+        std::fprintf(stderr,"socket path too long: %s\n",path);
+        return 1;
+    }
+    std::strcpy(addr.sun_path,path);
+    //既存のファイルはソケットの場合のみ削除する
+    struct stat st;
+    if(lstat(path,&st)==0){
+        if(!S_ISSOCK(st.st_mode)){
+            std::fprintf(stderr,"%s: exists and is not a socket\n",path);
+            return 1;
+        }
+        unlink(path);
+    }
+    else if(errno!=ENOENT){
+        std::perror(path);
+        return 1;
+    }
+    const int fd=socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd<0){
+        std::perror("socket");
+        return 1;
+    }
+    int wake[2];
+    if(bind(fd,reinterpret_cast<const sockaddr*>(&addr),sizeof(addr))<0 || listen(fd,SOMAXCONN)<0 || pipe(wake)<0){
+        std::perror(path);
+        close(fd);
+        return 1;
+    }
+    //メインスレッドはpoll以外では待たない
+    for(int f:{fd,wake[0],wake[1]})fcntl(f,F_SETFL,fcntl(f,F_GETFL)|O_NONBLOCK);
+    //ワーカーは接続が終わっても止めないので，キューは静的に持つ
+    static channel<job> jobs;
+    static channel<std::pair<int,bool>> done;
+    const unsigned workers=std::max(2u,std::thread::hardware_concurrency());
+    unsigned started=0;
+    for(;started<workers;started++){
+        try{
+            std::thread(worker<A>,std::ref(jobs),std::ref(done),wake[1]).detach();
+        }
+        catch(const std::system_error &e){
+            std::fprintf(stderr,"thread: %s\n",e.what());
+            break;
+        }
+    }
+    if(started==0){
+        close(fd);
+        return 1;
+    }
+    const timeval timeout{SEND_TIMEOUT,0};
+    //接続ごとの受信バッファ．busyはワーカーが処理中であることを表し，その間は受信しない．
+    struct client{
+        std::string buf;
+        bool busy=false;
+    };
+    std::map<int,client> clients;
+    std::vector<pollfd> fds;
+    std::vector<char> chunk(1<<16);
+    //受信済みの完全な行があればワーカーに渡す
+    auto dispatch=[&](const int c,client &cl){
+        const size_t last=cl.buf.rfind('\n');
+        const size_t len=(last==std::string::npos ? 0:last+1);
+        const bool too_long=cl.buf.size()-len>MAX_LINE;
+        if(len==0 && !too_long)return;
+        jobs.push({c,cl.buf.substr(0,len),too_long});
+        cl.buf.erase(0,len);
+        cl.busy=true;
+    };
+    bool accept_paused=false;
+    while(true){
+        fds.clear();
+        fds.push_back({wake[0],POLLIN,0});
+        if(!accept_paused)fds.push_back({fd,POLLIN,0});
+        for(auto &&[c,cl]:clients)if(!cl.busy)fds.push_back({c,POLLIN,0});
+        //fdが足りない場合は，接続が閉じられるのを待ってから受け付けを再開する
+        const int ready=poll(fds.data(),fds.size(),(accept_paused ? 100:-1));
+        accept_paused=false;
+        if(ready<0){
+            if(errno==EINTR)continue;
+            std::perror("poll");
+            break;
+        }
+        for(const pollfd &p:fds){
+            if(p.revents==0)continue;
+            if(p.fd==wake[0]){
+                char tmp[256];
+                while(read(wake[0],tmp,sizeof(tmp))>0);
+                std::pair<int,bool> r;
+                while(done.try_pop(r)){
+                    auto it=clients.find(r.first);
+                    if(!r.second){
+                        close(r.first);
+                        clients.erase(it);
+                        continue;
+                    }
+                    it->second.busy=false;
+                    dispatch(it->first,it->second);
+                }
+            }
+            else if(p.fd==fd){
+                const int conn=accept(fd,nullptr,nullptr);
+                if(conn<0){
+                    if(errno==EMFILE || errno==ENFILE || errno==ENOBUFS || errno==ENOMEM)accept_paused=true;
+                    else if(errno!=EINTR && errno!=ECONNABORTED && errno!=EAGAIN && errno!=EWOULDBLOCK){
+                        std::perror("accept");
+                        close(fd);
+                        return 1;
+                    }
+                    continue;
+                }
+                if(clients.size()>=MAX_CLIENTS){
+                    send(conn,"ERR busy\n",9,MSG_NOSIGNAL|MSG_DONTWAIT);
+                    close(conn);
+                    continue;
+                }
+                setsockopt(conn,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+                clients[conn];
+            }
+            else{
+                //この反復で閉じた・ワーカーに渡した接続は飛ばす（fdが再利用されている場合もあるので待たずに読む）
+                auto it=clients.find(p.fd);
+                if(it==clients.end() || it->second.busy)continue;
+                client &cl=it->second;
+                const ssize_t len=recv(p.fd,chunk.data(),chunk.size(),MSG_DONTWAIT);
+                if(len<0 && (errno==EINTR || errno==EAGAIN || errno==EWOULDBLOCK))continue;
+                if(len<=0){
+                    close(p.fd);
+                    clients.erase(it);
+                    continue;
+                }
+                cl.buf.append(chunk.data(),len);
+                dispatch(p.fd,cl);
+            }
+        }
+    }
+    close(fd);
+    return 1;
+}
+
+} // namespace qf_server_sp
+
+#endif // QF_SERVER
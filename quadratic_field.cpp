@@ -6,13 +6,23 @@
 #include <numeric>
 #include <set>
 #include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
 #include "basic_functions.hpp"
 #include "polynomial.hpp"
+#include "sqrt_table.hpp"
+#include "qf_server.hpp"
 
 //d:平方因子を持たず，0でも1でもなく，かつd≡2,3(mod4)を満たす整数．
 
 template<long long &d,typename T=long long>
 struct ring_of_integer{
+    //PrimeFactorizeで参照するx^2-d (mod p)の表．nullptrまたは表にないpの場合はその場で計算する．
+    inline static const sqrt_table_sp::table *table=nullptr;
+
+    struct ideal;
+
     //a+b√d
     struct elem{
         T a,b;
@@ -157,6 +167,45 @@ struct ring_of_integer{
             if(b<0)b+=v;
             return elem(a,b);
         }
+        // @return the vector of pairs(P,i) s.t. (*this) is a product of P^i.
+        //N(*this)を1度素因数分解し，各pについて付値を決める．Z[√d]のみ．
+        std::vector<std::pair<ideal,int>> PrimeFactorize()const{
+            assert((*this)!=0);
+            std::vector<std::pair<ideal,int>> res;
+            const T g=std::gcd(a,b);
+            for(auto [p,i]:prime_factorize(std::abs(norm()))){
+                const auto above=ideal::PrimesAbove(p);
+                //相対次数f=2：(p)^(i/2)
+                if(above.size()==1 && above[0].second==1){
+                    res.emplace_back(above[0].first,i/2);
+                }
+                //分岐：N(P)=p
+                else if(above.size()==1){
+                    res.emplace_back(above[0].first,i);
+                }
+                //分解：p^e||gcd(a,b)とすると，*this/p^eはPとその共役の高々一方でしか割り切れない
+                else{
+                    T q=1;
+                    int e=0;
+                    while(g%(q*p)==0)q*=p,e++;
+                    //P=(p,c+√d)では√d≡-c
+                    const ideal &P=above[0].first;
+                    assert(P.gen[1].b==1);
+                    const int v=((a/q-__int128(b/q%p)*P.gen[1].a)%p==0 ? i-e:e);
+                    if(v)res.emplace_back(P,v);
+                    if(i-v)res.emplace_back(above[1].first,i-v);
+                }
+            }
+            return res;
+        }
+        // @return the vector of the results of PrimeFactorize for each element of v.
+        //pの上の素イデアルはPrimesAboveのキャッシュで共有される．
+        static std::vector<std::vector<std::pair<ideal,int>>> PrimeFactorize(const std::vector<elem> &v){
+            std::vector<std::vector<std::pair<ideal,int>>> res;
+            res.reserve(v.size());
+            for(const elem &x:v)res.push_back(x.PrimeFactorize());
+            return res;
+        }
     };
 
     struct ideal{
@@ -172,7 +221,7 @@ struct ring_of_integer{
                 for(int i=0;i<int(F.size());i++)gen[i]=F[i];
                 return;
             }
-            int g=0;
+            T g=0;
             for(auto e:F)g=std::gcd(g,e.a),g=std::gcd(g,e.b);
             polynomial_sp::ideal<T> I(1);
             I.reserve(F.size()+1);
@@ -181,11 +230,28 @@ struct ring_of_integer{
                 I.push_back({e.a/g, e.b/g});
             }
             auto [a,b]=I.strong_grobner_basis_qf();
-            a[0]%=b[0],a[1]%=b[0];
-            gen[0]=elem(a[0],a[1])*g;
-            gen[1]=b[0]*g;
+            //Z基底{n,c+√d}のcを(-n/2,n/2]に取り，Gauss簡約して係数の増大を防ぐ
+            const T n=b[0];
+            T c=MOD(a[0],n);
+            if(2*c>n)c-=n;
+            elem u(n),v(c,1);
+            gauss_reduce(u,v);
+            gen[0]=v*g;
+            gen[1]=u*g;
             return;
         }
+        //Z基底(u,v)を係数ベクトル(a,b)のユークリッドノルムについてLagrange-Gauss簡約する．
+        //終了時，vが格子の最短ベクトルで|v|<=|u|．内積は係数の2乗になるため__int128で計算する．
+        static void gauss_reduce(elem &u,elem &v){
+            auto dot=[](const elem l,const elem r){return __int128(l.a)*r.a+__int128(l.b)*r.b;};
+            if(dot(u,u)<dot(v,v))swap(u,v);
+            while(true){
+                const T mu=round_div(dot(u,v),dot(v,v));
+                u-=elem(mu*v.a,mu*v.b);
+                if(dot(u,u)>=dot(v,v))break;
+                swap(u,v);
+            }
+        }
         ideal operator+(const ideal &r)const{
             return ideal({gen[0],gen[1],r.gen[0],r.gen[1]});
         }
@@ -194,7 +260,7 @@ struct ring_of_integer{
         }
         bool Contains(elem x){
             if(gen[0]==0 && gen[1]==0)return x==0;
-            const int gcd=std::gcd(std::gcd(gen[0].a, gen[0].b), std::gcd(gen[1].a, gen[1].b));
+            const T gcd=std::gcd(std::gcd(gen[0].a, gen[0].b), std::gcd(gen[1].a, gen[1].b));
             if(!x.is_divided_by(gcd))return false;
             x.a/=gcd,x.b/=gcd;
             polynomial_sp::polynomial<T> f({-d,0,1}),g({gen[0].a/gcd,gen[0].b/gcd}),h({gen[1].a/gcd,gen[1].b/gcd}), X({x.a,x.b});
@@ -208,6 +274,39 @@ struct ring_of_integer{
         bool operator==(ideal &r){
             return this->Contains(r) && r.Contains(*this);
         }
+        // @return the vector of pairs(P,e) s.t. (p) is a product of P^e.
+        //p<PRIMES_ABOVE_CACHE_MAXの場合は結果をprimes_above_cacheに保存する．複数スレッドから呼んでよい．
+        static std::vector<std::pair<ideal,int>> PrimesAbove(const long long p){
+            //大きいpはその場で計算する（常駐モードでキャッシュがクライアントの入力に応じて増え続けないように）
+            if(p>=PRIMES_ABOVE_CACHE_MAX)return ComputePrimesAbove(p);
+            std::lock_guard<std::mutex> lock(primes_above_mtx);
+            auto [it,inserted]=primes_above_cache.try_emplace({d,p});
+            if(inserted)it->second=ComputePrimesAbove(p);
+            return it->second;
+        }
+        //分解型は表（あれば）またはSplitTypeで，根はTonelli-Shanksで求める．多項式の因数分解は行わない．
+        static std::vector<std::pair<ideal,int>> ComputePrimesAbove(const long long p){
+            std::vector<std::pair<ideal,int>> res;
+            sqrt_table_sp::split_type type;
+            uint32_t root;
+            long long r;
+            if(table!=nullptr && table->lookup(d,p,type,root)){
+                r=root;
+            }
+            else{
+                type=SplitType(p);
+                r=(type==sqrt_table_sp::split ? sqrt_table_sp::sqrt_mod(MOD(d,p),p):MOD(d,p));
+            }
+            //相対次数f=2
+            if(type==sqrt_table_sp::inert)res.emplace_back(ideal({elem(p)}),1);
+            //相対次数f=1
+            else if(type==sqrt_table_sp::ramified)res.emplace_back(ideal({elem(p),elem(MOD(-r,p),1)}),2);
+            else{
+                res.emplace_back(ideal({elem(p),elem(MOD(-r,p),1)}),1);
+                res.emplace_back(ideal({elem(p),elem(r,1)}),1);
+            }
+            return res;
+        }
         // @return the vector of pairs(p,i) s.t. (*this) is a product of p^i.
         std::vector<std::pair<ideal,int>> PrimeFactorize()const{
             std::vector<std::pair<ideal,int>> res;
@@ -215,17 +314,7 @@ struct ring_of_integer{
             long long g=std::gcd(std::gcd(gen[0].a,gen[0].b),std::gcd(gen[1].a,gen[1].b));
 
             for(auto [p,i]:prime_factorize(g)){
-                polynomial_sp::init(p);
-                auto fac=polynomial_sp::factorize(polynomial_sp::polynomial<polynomial_sp::mint>({-d,0,1}),p);
-
-                //相対次数f=2
-                if(fac.size()==1 && fac[0].second==1){
-                    res.emplace_back(ideal({elem(p)}),i);
-                }
-                //相対次数f=1
-                else{
-                    for(auto [poly,j]:fac)res.emplace_back(ideal({elem(p),elem(poly[0].val(),poly[1].val())}),i*j);
-                }
+                for(auto [P,j]:PrimesAbove(p))res.emplace_back(P,i*j);
             }
 
             polynomial_sp::ideal<T> I({{-d,0,1},{gen[0].a/g,gen[0].b/g},{gen[1].a/g,gen[1].b/g}});
@@ -240,6 +329,180 @@ struct ring_of_integer{
             return res;
         }
     };
+    //これ未満の素数についてのみPrimesAboveの結果を保存する（高々82025個）
+    static constexpr long long PRIMES_ABOVE_CACHE_MAX=1<<20;
+    //(d,p) -> ideal::PrimesAbove(p)
+    inline static std::map<std::pair<long long,long long>,std::vector<std::pair<ideal,int>>> primes_above_cache;
+    inline static std::mutex primes_above_mtx;
+
+    //4|d|がこれを超える場合は剰余類の表を作らない
+    static constexpr long long RESIDUE_TABLE_MAX=1<<26;
+    //d -> ResidueClassTable()
+    inline static std::map<long long,std::vector<sqrt_table_sp::split_type>> residue_class_tables;
+    inline static std::mutex residue_class_mtx;
+
+    //x^2-d (mod p)の分解型をp mod 4|d|ごとに並べた表．
+    //4|d|を割る素数は分岐し，それ以外の素数pではKronecker記号(4d/p)のみで決まる（平方剰余の相互法則）．
+    //4|d|>RESIDUE_TABLE_MAXの場合は空．
+    static const std::vector<sqrt_table_sp::split_type>& ResidueClassTable(){
+        thread_local const std::vector<sqrt_table_sp::split_type> *cache=nullptr;
+        thread_local long long cache_d=0;
+        if(cache!=nullptr && cache_d==d)return *cache;
+        std::lock_guard<std::mutex> lock(residue_class_mtx);
+        auto [it,inserted]=residue_class_tables.try_emplace(d);
+        const long long m=4*std::abs(d);
+        if(inserted && m<=RESIDUE_TABLE_MAX){
+            auto &tab=it->second;
+            tab.resize(m);
+            for(long long r=0;r<m;r++){
+                if(std::gcd(r,m)!=1)tab[r]=sqrt_table_sp::ramified;
+                else tab[r]=(jacobi(4*d,r)==1 ? sqrt_table_sp::split:sqrt_table_sp::inert);
+            }
+        }
+        cache=&it->second;
+        cache_d=d;
+        return *cache;
+    }
+    // pは素数．表がない場合はEulerの規準で計算する．
+    // @return the splitting type of x^2-d (mod p).
+    static sqrt_table_sp::split_type SplitType(const long long p){
+        const auto &tab=ResidueClassTable();
+        if(tab.empty())return sqrt_table_sp::classify_type(d,p);
+        return tab[p%tab.size()];
+    }
+    // @return the vector of SplitType(p) for each p in primes.
+    static std::vector<sqrt_table_sp::split_type> SplitTypes(const std::vector<long long> &primes){
+        const auto &tab=ResidueClassTable();
+        std::vector<sqrt_table_sp::split_type> res(primes.size());
+        if(tab.empty()){
+            for(size_t i=0;i<primes.size();i++)res[i]=sqrt_table_sp::classify_type(d,primes[i]);
+        }
+        else{
+            const long long m=tab.size();
+            for(size_t i=0;i<primes.size();i++)res[i]=tab[primes[i]%m];
+        }
+        return res;
+    }
+
+    //剰余環A/I．Z[√d]のみ．
+    //I=g((c+√d)Z+nZ)（0<=c<n）と書けるので，{x+y√d | 0<=x<gn, 0<=y<g}が完全代表系になる．
+    //x+y√dに添字y*gn+xを割り当て，元は添字（uint32_t）の配列として扱う．
+    //N(I)<2^31が必要．
+    struct residue_ring{
+        ideal I;
+        T g,c,n,u,N;
+
+        residue_ring(const ideal &_I):I(_I){
+            std::tie(g,c,n)=hnf(I);
+            u=g*n;
+            N=u*g;
+            assert(N<(1ll<<31));
+        }
+        // @return tuple(g,c,n) s.t. I=g((c+√d)Z+nZ), 0<=c<n.
+        static std::tuple<T,T,T> hnf(const ideal &I){
+            assert(I.gen[0]!=0 || I.gen[1]!=0);
+            const T g=std::gcd(std::gcd(I.gen[0].a,I.gen[0].b),std::gcd(I.gen[1].a,I.gen[1].b));
+            polynomial_sp::ideal<T> J({{-d,0,1},{I.gen[0].a/g,I.gen[0].b/g},{I.gen[1].a/g,I.gen[1].b/g}});
+            auto [l,r]=J.strong_grobner_basis_qf();
+            return {g,MOD(l[0],r[0]),r[0]};
+        }
+        // @return N(I)=|A/I|
+        T size()const{
+            return N;
+        }
+        // @return the index of a+b√d
+        uint32_t reduce(const T a,const T b)const{
+            //a+b√dから((b-y)/g)g(c+√d)を引いてyを代表元にする．kはmod nで良い．
+            const T y=MOD(b,g),k=MOD((b-y)/g,n);
+            return y*u+MOD(a-g*(k*c%n),u);
+        }
+        uint32_t index(const elem x)const{
+            return reduce(x.a,x.b);
+        }
+        elem element(const uint32_t i)const{
+            return elem(i%u,i/u);
+        }
+        //z[i]=x[i]+y[i]（z=x,z=yでも良い）
+        void add(const uint32_t *x,const uint32_t *y,uint32_t *z,const size_t len)const{
+            const T gc=g*c%u;
+            for(size_t i=0;i<len;i++){
+                T a=T(x[i]%u)+y[i]%u,b=T(x[i]/u)+y[i]/u;
+                //b>=gならg(c+√d)を引く
+                const T carry=(b>=g);
+                b-=carry*g;
+                a-=carry*gc;
+                a+=(a<0)*u;
+                a-=(a>=u)*u;
+                z[i]=b*u+a;
+            }
+        }
+        //z[i]=x[i]*y[i]（z=x,z=yでも良い）
+        void mul(const uint32_t *x,const uint32_t *y,uint32_t *z,const size_t len)const{
+            for(size_t i=0;i<len;i++){
+                const T x0=x[i]%u,x1=x[i]/u,y0=y[i]%u,y1=y[i]/u;
+                z[i]=reduce(x0*y0+x1*y1%u*d,x0*y1+x1*y0);
+            }
+        }
+        //z[i]=x[i]^e（z=xでも良い）
+        void pow(const uint32_t *x,long long e,uint32_t *z,const size_t len)const{
+            assert(e>=0);
+            std::vector<uint32_t> base(x,x+len);
+            std::fill(z,z+len,index(1));
+            while(e){
+                if(e&1)mul(z,base.data(),z,len);
+                mul(base.data(),base.data(),base.data(),len);
+                e/=2;
+            }
+        }
+        uint32_t pow(const uint32_t x,const long long e)const{
+            uint32_t z;
+            pow(&x,e,&z,1);
+            return z;
+        }
+        // @return table s.t. table[i*N+j]=i*j
+        std::vector<uint32_t> mul_table()const{
+            std::vector<uint32_t> all(N),row(N),res(N*N);
+            std::iota(all.begin(),all.end(),0u);
+            for(T i=0;i<N;i++){
+                std::fill(row.begin(),row.end(),uint32_t(i));
+                mul(row.data(),all.data(),res.data()+i*N,N);
+            }
+            return res;
+        }
+        // @return |(A/I)^*|
+        T unit_count()const{
+            T res=1;
+            for(auto [P,e]:I.PrimeFactorize()){
+                auto [gP,cP,nP]=hnf(P);
+                const T q=gP*gP*nP;
+                res*=q-1;
+                for(int j=1;j<e;j++)res*=q;
+            }
+            return res;
+        }
+        // (A/I)^*が巡回群でない場合は空．
+        // @return table s.t. table[i]=k (i=h^k, hは(A/I)^*の生成元), table[i]=-1 (iが単元でない)
+        std::vector<long long> dlog_table()const{
+            const T phi=unit_count();
+            const uint32_t one=index(1);
+            const auto fac=prime_factorize(phi);
+            for(T h=0;h<N;h++){
+                if(pow(h,phi)!=one)continue;
+                bool generator=true;
+                for(auto [q,i]:fac)if(pow(h,phi/q)==one)generator=false;
+                if(!generator)continue;
+                std::vector<long long> res(N,-1);
+                uint32_t x=one;
+                for(T k=0;k<phi;k++){
+                    res[x]=k;
+                    const uint32_t y=h;
+                    mul(&x,&y,&x,1);
+                }
+                return res;
+            }
+            return {};
+        }
+    };
 };
 
 bool is_PrimeNumber(int p){
@@ -251,8 +514,28 @@ bool is_PrimeNumber(int p){
 
 long long d=7;
 
-int main(){
+int main(int argc,char **argv){
     using A=ring_of_integer<d>;
+    //quadratic_field [表]
+    //quadratic_field --serve ソケットのパス [表]
+    //表：make_sqrt_tableで生成したもの（省略可）
+    const bool serve=(argc>=3 && std::string(argv[1])=="--serve");
+    const int table_arg=(serve ? 3:1);
+    sqrt_table_sp::table table;
+    //表が使えない場合も計算はできるが，気づけるように警告する
+    if(argc>table_arg){
+        if(!table.open(argv[table_arg])){
+            std::cerr << "warning: " << argv[table_arg] << ": cannot open as a sqrt table (missing, corrupt or version mismatch); computing without it\n";
+        }
+        else if(table.h->d!=d){
+            std::cerr << "warning: " << argv[table_arg] << ": made for d=" << table.h->d << ", not d=" << d << "; computing without it\n";
+            table.close();
+        }
+        else A::table=&table;
+    }
+    if(serve){
+        return qf_server_sp::serve<A>(argv[2]);
+    }
     std::vector<int> PrimeIdeal(1001,-1);
     /*
     PrimeIdeal[i]=
@@ -260,17 +543,14 @@ int main(){
      - iが素数であるが素イデアルを生成しない：0 ->'.'を出力
      - iが素数であり素イデアルを生成する：1    ->'#'を出力
     */
+    //素イデアルを生成する⇔x^2-dがmod iで既約．分解型はp mod 4|d|の表から引く．
+    std::vector<long long> primes;
     for(int i=2;i<=1000;i++){
-        if(is_PrimeNumber(i)){
-            A::ideal I({i});
-            auto v=I.PrimeFactorize();
-            if(v.size()==1 && v.front().second==1){
-                PrimeIdeal[i]=1;
-            }
-            else{
-                PrimeIdeal[i]=0;
-            }
-        }
+        if(is_PrimeNumber(i))primes.push_back(i);
+    }
+    auto types=A::SplitTypes(primes);
+    for(size_t j=0;j<primes.size();j++){
+        PrimeIdeal[primes[j]]=(types[j]==sqrt_table_sp::inert ? 1:0);
     }
 
     int m;
@@ -292,5 +572,6 @@ i=0,1,...,1000について，次の操作を行う：
 さらに，iがmの倍数になる毎に改行する（mは標準入力から与える）．
 
 m=20を入力として与えると規則的な様子が観察される．
+（平方剰余の相互法則により，4|d|を割らない素数iについて結果はi mod 4|d|のみで決まる．m=28とすると列ごとに揃う．）
 d,mの値を適当に変えることで様々な実験が可能（ただしdはmod4で2,3のいずれか，かつ平方因子を持ってはならない）．
 */
\ No newline at end of file
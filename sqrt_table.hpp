@@ -0,0 +1,221 @@
+#ifndef SQRT_TABLE
+#define SQRT_TABLE
+
+#include <cstdint>
+#include <cstdio>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "basic_functions.hpp"
+
+//固定したdについて，素数p<limitごとのx^2-d (mod p)の分解型と根を保存した表．
+//write_tableで生成し，tableでmmapして参照する（読み込み時にコピーはしない）．
+//
+//ファイル形式（version 2，ネイティブのバイト順）：
+// header : magic | version | d | limit | count
+// bitmap : uint64 * W （奇数2i+1<limitが素数 ⇔ 第i bitが1．W=ceil((limit/2)/64)）
+// rank   : uint32 * W （bitmap[w]より前の奇素数の個数）
+// roots  : uint32 * count （素数の小さい順．不分解の場合は0，分解する場合はr<=p-rとなる方）
+// types  : 2bit * count （4個ずつ1byteに詰める）
+//素数の番号は，2が0番，奇素数pは1+(p未満の奇素数の個数)番．
+//rootsは素数ごとに必要な情報そのものなので詰めずに持つ（limit=2^32で約0.8GB，全体で約1.25GB）．
+
+namespace sqrt_table_sp{
+
+enum split_type : uint8_t {inert=0, split=1, ramified=2};
+
+constexpr uint32_t MAGIC=0x54534651;// "QFST"
+constexpr uint32_t VERSION=2;
+
+struct header{
+    uint32_t magic,version;
+    int64_t d;
+    uint64_t limit,count;
+};
+
+//p<2^63ならば積がオーバーフローしない
+uint64_t mulmod(const uint64_t a,const uint64_t b,const uint64_t p){
+    return (unsigned __int128)a*b%p;
+}
+
+uint64_t powmod(uint64_t a,uint64_t n,const uint64_t p){
+    uint64_t res=1;
+    a%=p;
+    while(n){
+        if(n&1)res=mulmod(res,a,p);
+        a=mulmod(a,a,p);
+        n/=2;
+    }
+    return res;
+}
+
+// Tonelli-Shanks.
+// 仮定：pは奇素数，aはpの倍数でない平方剰余．
+// @return r s.t. r^2=a mod p
+uint64_t sqrt_mod(uint64_t a,const uint64_t p){
+    a%=p;
+    uint64_t q=p-1,s=0;
+    while(q%2==0)q/=2,s++;
+    uint64_t z=2;
+    while(powmod(z,(p-1)/2,p)!=p-1)z++;
+    uint64_t m=s,c=powmod(z,q,p),t=powmod(a,q,p),r=powmod(a,(q+1)/2,p);
+    while(t!=1){
+        uint64_t i=0,t2=t;
+        while(t2!=1)t2=mulmod(t2,t2,p),i++;
+        uint64_t b=c;
+        for(uint64_t j=0;j+1<m-i;j++)b=mulmod(b,b,p);
+        m=i;
+        c=mulmod(b,b,p);
+        t=mulmod(t,c,p);
+        r=mulmod(r,b,p);
+    }
+    return r;
+}
+
+// x^2-d (mod p) の分解型を返す．pは2^63未満の素数．
+split_type classify_type(const long long d,const uint64_t p){
+    const uint64_t a=MOD(d,p);
+    if(p==2 || a==0)return ramified;
+    return (powmod(a,(p-1)/2,p)==1 ? split:inert);
+}
+
+// x^2-d (mod p) の分解型と根を返す．
+std::pair<split_type,uint32_t> classify(const long long d,const uint32_t p){
+    const split_type type=classify_type(d,p);
+    const uint64_t a=MOD(d,p);
+    if(type==inert)return {inert,0};
+    if(type==ramified)return {ramified,uint32_t(a)};
+    const uint64_t r=sqrt_mod(a,p);
+    return {split,uint32_t(std::min(r,p-r))};
+}
+
+// @return the number of 64-bit words of the bitmap for limit.
+uint64_t bitmap_words(const uint64_t limit){
+    return (limit/2+63)/64;
+}
+
+// @return true iff the table is written successfully.
+// limitは2^32以下．篩にlimit/2 bitのメモリを使う．
+bool write_table(const long long d,const uint64_t limit,const char *path){
+    assert(limit<=(uint64_t(1)<<32));
+    const uint64_t nbits=limit/2,W=bitmap_words(limit);
+    //奇数のみの篩
+    std::vector<uint64_t> bitmap(W,~uint64_t(0));
+    if(nbits%64)bitmap.back()=(uint64_t(1)<<(nbits%64))-1;
+    if(nbits)bitmap[0]&=~uint64_t(1);//1は素数でない
+    for(uint64_t i=1;(2*i+1)*(2*i+1)<limit;i++){
+        if(!(bitmap[i/64]>>(i%64)&1))continue;
+        const uint64_t p=2*i+1;
+        for(uint64_t j=p*p/2;j<nbits;j+=p)bitmap[j/64]&=~(uint64_t(1)<<(j%64));
+    }
+    std::vector<uint32_t> rank(W),roots;
+    std::vector<uint8_t> types;
+    auto push=[&](const uint32_t p){
+        auto [type,root]=classify(d,p);
+        if(roots.size()%4==0)types.push_back(0);
+        types.back()|=type<<(roots.size()%4*2);
+        roots.push_back(root);
+    };
+    if(limit>2)push(2);
+    uint32_t cnt=0;
+    for(uint64_t w=0;w<W;w++){
+        rank[w]=cnt;
+        for(uint64_t x=bitmap[w];x;x&=x-1){
+            push(2*(w*64+__builtin_ctzll(x))+1);
+            cnt++;
+        }
+    }
+    const header h{MAGIC,VERSION,d,limit,roots.size()};
+    FILE *fp=std::fopen(path,"wb");
+    if(fp==nullptr)return false;
+    auto write=[fp](const void *data,const size_t size,const size_t n){
+        return n==0 || std::fwrite(data,size,n,fp)==n;
+    };
+    bool ok=write(&h,sizeof(h),1);
+    ok&=write(bitmap.data(),sizeof(uint64_t),W);
+    ok&=write(rank.data(),sizeof(uint32_t),W);
+    ok&=write(roots.data(),sizeof(uint32_t),roots.size());
+    ok&=write(types.data(),1,types.size());
+    ok&=std::fclose(fp)==0;
+    return ok;
+}
+
+struct table{
+    void *base=MAP_FAILED;
+    size_t length=0;
+    const header *h=nullptr;
+    const uint64_t *bitmap=nullptr;
+    const uint32_t *rank=nullptr,*roots=nullptr;
+    const uint8_t *types=nullptr;
+
+    table(){}
+    table(const char *path){
+        open(path);
+    }
+    table(const table&)=delete;
+    table& operator=(const table&)=delete;
+    ~table(){
+        close();
+    }
+
+    // @return true iff the file is mapped and its header is valid.
+    bool open(const char *path){
+        close();
+        const int fd=::open(path,O_RDONLY);
+        if(fd<0)return false;
+        struct stat st;
+        if(fstat(fd,&st)==0 && size_t(st.st_size)>=sizeof(header)){
+            length=st.st_size;
+            base=mmap(nullptr,length,PROT_READ,MAP_SHARED,fd,0);
+        }
+        ::close(fd);
+        if(base==MAP_FAILED)return false;
+        h=static_cast<const header*>(base);
+        //countとlimitを先に抑えてからサイズを計算する（オーバーフロー防止）
+        const uint64_t n=h->count,limit=h->limit;
+        if(h->magic!=MAGIC || h->version!=VERSION || limit>(uint64_t(1)<<32) || n>limit
+           || length!=sizeof(header)+bitmap_words(limit)*12+n*4+(n+3)/4){
+            close();
+            return false;
+        }
+        bitmap=reinterpret_cast<const uint64_t*>(h+1);
+        rank=reinterpret_cast<const uint32_t*>(bitmap+bitmap_words(limit));
+        roots=rank+bitmap_words(limit);
+        types=reinterpret_cast<const uint8_t*>(roots+n);
+        return true;
+    }
+    void close(){
+        if(base!=MAP_FAILED)munmap(base,length);
+        base=MAP_FAILED;
+        length=0;
+        h=nullptr;
+        bitmap=nullptr;
+        rank=roots=nullptr;
+        types=nullptr;
+    }
+    bool is_open()const{
+        return h!=nullptr;
+    }
+
+    // @return true iff p is found in the table made for d.
+    bool lookup(const long long d,const long long p,split_type &type,uint32_t &root)const{
+        if(!is_open() || h->d!=d || p<2 || uint64_t(p)>=h->limit)return false;
+        size_t i=0;
+        if(p!=2){
+            const uint64_t j=p/2,w=j/64,mask=uint64_t(1)<<(j%64);
+            if(p%2==0 || !(bitmap[w]&mask))return false;
+            i=1+rank[w]+__builtin_popcountll(bitmap[w]&(mask-1));
+        }
+        type=split_type(types[i/4]>>(i%4*2)&3);
+        root=roots[i];
+        return true;
+    }
+};
+
+} // namespace sqrt_table_sp
+
+#endif // SQRT_TABLE